@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sched.h>
+
+#include "irqstat.h"
+
+struct irqstat *
+irqstat_alloc( void )
+{
+    struct irqstat *stat;
+    long ncpus = sysconf( _SC_NPROCESSORS_CONF );
+
+    if ( ncpus < 1 ) {
+        ncpus = 1;
+    }
+    stat = (struct irqstat *) calloc( 1, sizeof( struct irqstat ) );
+    if ( stat == NULL ) {
+        return NULL;
+    }
+    stat->ncpus = (int) ncpus;
+    stat->maxlines = IRQ_INIT_LINES;
+    stat->name = calloc( stat->maxlines, IRQ_NAME_LEN );
+    stat->desc = calloc( stat->maxlines, IRQ_DESC_LEN );
+    stat->irqs = (unsigned long *) calloc( stat->maxlines * ncpus,
+                                           sizeof( unsigned long ) );
+    stat->softirqs = (unsigned long *) calloc( IRQ_MAX_SOFTIRQ * ncpus,
+                                               sizeof( unsigned long ) );
+    stat->irq_ticks = (unsigned long long *) calloc( ncpus,
+                                            sizeof( unsigned long long ) );
+    stat->softirq_ticks = (unsigned long long *) calloc( ncpus,
+                                            sizeof( unsigned long long ) );
+    if ( stat->name == NULL || stat->desc == NULL ||
+         stat->irqs == NULL || stat->softirqs == NULL ||
+         stat->irq_ticks == NULL || stat->softirq_ticks == NULL ) {
+        irqstat_free( stat );
+        return NULL;
+    }
+    return stat;
+}
+
+void
+irqstat_free( struct irqstat *stat )
+{
+    if ( stat == NULL ) {
+        return;
+    }
+    free( stat->name );
+    free( stat->desc );
+    free( stat->irqs );
+    free( stat->softirqs );
+    free( stat->irq_ticks );
+    free( stat->softirq_ticks );
+    free( stat );
+}
+
+/*
+ * Parse the "CPU0 CPU1 ..." header shared by /proc/interrupts and
+ * /proc/softirqs.  Offline CPUs are omitted from the header, so each column
+ * is mapped back to its kernel CPU number.  Returns the number of columns.
+ */
+static int
+parse_cpu_header( const char *line, int *cols, int max_cols )
+{
+    int ncols = 0;
+    const char *p = line;
+
+    while ( ( p = strstr( p, "CPU" ) ) != NULL && ncols < max_cols ) {
+        char *end;
+        p += 3;
+        cols[ncols++] = (int) strtol( p, &end, 10 );
+        p = end;
+    }
+    return ncols;
+}
+
+/*
+ * Parse one "NAME: count count ... description" row.  Returns the number of
+ * counters read and leaves *rest pointing at the trailing description.
+ */
+static int
+parse_counter_row( char *line, char *name, unsigned long *counts,
+                   int ncols, char **rest )
+{
+    char *p = line, *colon, *end;
+    int n = 0;
+
+    while ( isspace( (unsigned char) *p ) ) {
+        ++p;
+    }
+    colon = strchr( p, ':' );
+    if ( colon == NULL ) {
+        return -1;
+    }
+    *colon = '\0';
+    strncpy( name, p, IRQ_NAME_LEN - 1 );
+    name[IRQ_NAME_LEN - 1] = '\0';
+
+    p = colon + 1;
+    while ( n < ncols ) {
+        unsigned long v = strtoul( p, &end, 10 );
+        if ( end == p ) {
+            break;
+        }
+        counts[n++] = v;
+        p = end;
+    }
+    while ( isspace( (unsigned char) *p ) ) {
+        ++p;
+    }
+    *rest = p;
+    return n;
+}
+
+/* Double the interrupt table, zeroing the new rows. */
+static int
+grow_lines( struct irqstat *stat )
+{
+    int maxlines = stat->maxlines * 2;
+    char (*name)[IRQ_NAME_LEN];
+    char (*desc)[IRQ_DESC_LEN];
+    unsigned long *irqs;
+
+    name = realloc( stat->name, (size_t) maxlines * IRQ_NAME_LEN );
+    if ( name == NULL ) {
+        return -1;
+    }
+    stat->name = name;
+    desc = realloc( stat->desc, (size_t) maxlines * IRQ_DESC_LEN );
+    if ( desc == NULL ) {
+        return -1;
+    }
+    stat->desc = desc;
+    irqs = (unsigned long *) realloc( stat->irqs, sizeof( unsigned long ) *
+                                      maxlines * stat->ncpus );
+    if ( irqs == NULL ) {
+        return -1;
+    }
+    stat->irqs = irqs;
+    memset( stat->irqs + stat->maxlines * stat->ncpus, 0,
+            sizeof( unsigned long ) * stat->maxlines * stat->ncpus );
+    stat->maxlines = maxlines;
+    return 0;
+}
+
+static int
+snapshot_interrupts( struct irqstat *stat )
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int *cols, ncols, i;
+    unsigned long *counts;
+
+    fp = fopen( "/proc/interrupts", "r" );
+    if ( fp == NULL ) {
+        return -1;
+    }
+    cols = (int *) malloc( sizeof( int ) * stat->ncpus );
+    counts = (unsigned long *) malloc( sizeof( unsigned long ) * stat->ncpus );
+    if ( cols == NULL || counts == NULL || getline( &line, &len, fp ) < 0 ) {
+        free( cols );
+        free( counts );
+        free( line );
+        fclose( fp );
+        return -1;
+    }
+    ncols = parse_cpu_header( line, cols, stat->ncpus );
+
+    stat->nlines = 0;
+    memset( stat->irqs, 0,
+            sizeof( unsigned long ) * stat->maxlines * stat->ncpus );
+    while ( getline( &line, &len, fp ) > 0 ) {
+        int idx = stat->nlines, n;
+        char *rest;
+
+        if ( idx == stat->maxlines && grow_lines( stat ) != 0 ) {
+            free( cols );
+            free( counts );
+            free( line );
+            fclose( fp );
+            return -1;
+        }
+        n = parse_counter_row( line, stat->name[idx], counts, ncols, &rest );
+        if ( n <= 0 ) {
+            continue;
+        }
+        /* ERR/MIS are system wide totals, not per CPU */
+        if ( n < ncols ) {
+            continue;
+        }
+        for ( i = 0; i < n; ++i ) {
+            if ( cols[i] >= 0 && cols[i] < stat->ncpus ) {
+                stat->irqs[idx * stat->ncpus + cols[i]] = counts[i];
+            }
+        }
+        /* squeeze the column padding so the device name survives */
+        for ( i = 0; *rest != '\0' && i < IRQ_DESC_LEN - 1; ++rest ) {
+            if ( isspace( (unsigned char) *rest ) ) {
+                if ( i > 0 && stat->desc[idx][i - 1] == ' ' ) {
+                    continue;
+                }
+                stat->desc[idx][i++] = ' ';
+            }
+            else {
+                stat->desc[idx][i++] = *rest;
+            }
+        }
+        while ( i > 0 && stat->desc[idx][i - 1] == ' ' ) {
+            --i;
+        }
+        stat->desc[idx][i] = '\0';
+        stat->nlines++;
+    }
+
+    free( cols );
+    free( counts );
+    free( line );
+    fclose( fp );
+    return 0;
+}
+
+static int
+snapshot_softirqs( struct irqstat *stat )
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int *cols, ncols, i;
+    unsigned long *counts;
+
+    fp = fopen( "/proc/softirqs", "r" );
+    if ( fp == NULL ) {
+        return -1;
+    }
+    cols = (int *) malloc( sizeof( int ) * stat->ncpus );
+    counts = (unsigned long *) malloc( sizeof( unsigned long ) * stat->ncpus );
+    if ( cols == NULL || counts == NULL || getline( &line, &len, fp ) < 0 ) {
+        free( cols );
+        free( counts );
+        free( line );
+        fclose( fp );
+        return -1;
+    }
+    ncols = parse_cpu_header( line, cols, stat->ncpus );
+
+    stat->nsoftirqs = 0;
+    memset( stat->softirqs, 0,
+            sizeof( unsigned long ) * IRQ_MAX_SOFTIRQ * stat->ncpus );
+    while ( stat->nsoftirqs < IRQ_MAX_SOFTIRQ &&
+            getline( &line, &len, fp ) > 0 ) {
+        int idx = stat->nsoftirqs, n;
+        char *rest;
+
+        n = parse_counter_row( line, stat->softirq_name[idx], counts, ncols,
+                               &rest );
+        if ( n <= 0 ) {
+            continue;
+        }
+        for ( i = 0; i < n; ++i ) {
+            if ( cols[i] >= 0 && cols[i] < stat->ncpus ) {
+                stat->softirqs[idx * stat->ncpus + cols[i]] = counts[i];
+            }
+        }
+        stat->nsoftirqs++;
+    }
+
+    free( cols );
+    free( counts );
+    free( line );
+    fclose( fp );
+    return 0;
+}
+
+static int
+snapshot_stat( struct irqstat *stat )
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+
+    fp = fopen( "/proc/stat", "r" );
+    if ( fp == NULL ) {
+        return -1;
+    }
+    memset( stat->irq_ticks, 0, sizeof( unsigned long long ) * stat->ncpus );
+    memset( stat->softirq_ticks, 0,
+            sizeof( unsigned long long ) * stat->ncpus );
+    while ( getline( &line, &len, fp ) > 0 ) {
+        int cpu;
+        unsigned long long user, nice, sys, idle, iowait, irq, softirq;
+
+        if ( strncmp( line, "cpu", 3 ) != 0 ||
+             !isdigit( (unsigned char) line[3] ) ) {
+            continue;
+        }
+        if ( sscanf( line, "cpu%d %llu %llu %llu %llu %llu %llu %llu", &cpu,
+                     &user, &nice, &sys, &idle, &iowait, &irq,
+                     &softirq ) != 8 ) {
+            continue;
+        }
+        if ( cpu >= 0 && cpu < stat->ncpus ) {
+            stat->irq_ticks[cpu] = irq;
+            stat->softirq_ticks[cpu] = softirq;
+        }
+    }
+    free( line );
+    fclose( fp );
+    return 0;
+}
+
+int
+irqstat_snapshot( struct irqstat *stat )
+{
+    if ( snapshot_interrupts( stat ) != 0 ) {
+        return -1;
+    }
+    if ( snapshot_softirqs( stat ) != 0 ) {
+        return -1;
+    }
+    if ( snapshot_stat( stat ) != 0 ) {
+        return -1;
+    }
+    return 0;
+}
+
+static unsigned long
+counter_delta( unsigned long before, unsigned long after )
+{
+    return after > before ? after - before : 0;
+}
+
+/* A CPU missing from one /proc/stat snapshot reads as 0 ticks. */
+static unsigned long long
+tick_delta( unsigned long long before, unsigned long long after )
+{
+    return after > before ? after - before : 0;
+}
+
+/* Find the row in 'before' matching row 'idx' of 'after'. */
+static int
+find_line( char names[][IRQ_NAME_LEN], int count, const char *name, int idx )
+{
+    int i;
+
+    if ( idx < count && strcmp( names[idx], name ) == 0 ) {
+        return idx;
+    }
+    for ( i = 0; i < count; ++i ) {
+        if ( strcmp( names[i], name ) == 0 ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Field order of the per CPU records irqstat_report prints in CSV mode. */
+void
+irqstat_csv_header( FILE *out )
+{
+    fprintf( out, "[NN] irq,interval,cpu,irqs,softirqs,irq_ticks,"
+             "softirq_ticks,top_irq,top_irq_count,top_softirq,"
+             "top_softirq_count\n" );
+}
+
+void
+irqstat_report( FILE *out, int thread_id, unsigned long interval,
+                int use_csv, cpu_set_t *cpus,
+                struct irqstat *before, struct irqstat *after )
+{
+    unsigned long *irq_delta;
+    int cpu, i, j;
+
+    irq_delta = (unsigned long *) malloc( sizeof( unsigned long ) *
+                                          ( after->nlines + 1 ) );
+    if ( irq_delta == NULL ) {
+        fprintf( stderr, "[%02d] irqstat malloc failed.\n", thread_id );
+        return;
+    }
+    for ( cpu = 0; cpu < after->ncpus; ++cpu ) {
+        unsigned long irq_total = 0, softirq_total = 0;
+        unsigned long softirq_delta[IRQ_MAX_SOFTIRQ];
+        int top[IRQ_REPORT_TOP], ntop = 0, top_softirq = -1;
+
+        if ( !CPU_ISSET( cpu, cpus ) ) {
+            continue;
+        }
+
+        for ( i = 0; i < after->nlines; ++i ) {
+            int b = find_line( before->name, before->nlines,
+                               after->name[i], i );
+            irq_delta[i] = b < 0 ? 0 : counter_delta(
+                    before->irqs[b * before->ncpus + cpu],
+                    after->irqs[i * after->ncpus + cpu] );
+            irq_total += irq_delta[i];
+        }
+        for ( i = 0; i < after->nsoftirqs; ++i ) {
+            int b = find_line( before->softirq_name, before->nsoftirqs,
+                               after->softirq_name[i], i );
+            softirq_delta[i] = b < 0 ? 0 : counter_delta(
+                    before->softirqs[b * before->ncpus + cpu],
+                    after->softirqs[i * after->ncpus + cpu] );
+            softirq_total += softirq_delta[i];
+            if ( softirq_delta[i] > 0 && ( top_softirq < 0 ||
+                 softirq_delta[i] > softirq_delta[top_softirq] ) ) {
+                top_softirq = i;
+            }
+        }
+
+        /* insertion sort of the busiest interrupt lines on this CPU */
+        for ( i = 0; i < after->nlines; ++i ) {
+            if ( irq_delta[i] == 0 ) {
+                continue;
+            }
+            for ( j = ntop; j > 0 && irq_delta[top[j - 1]] < irq_delta[i];
+                  --j ) {
+                if ( j < IRQ_REPORT_TOP ) {
+                    top[j] = top[j - 1];
+                }
+            }
+            if ( j < IRQ_REPORT_TOP ) {
+                top[j] = i;
+                if ( ntop < IRQ_REPORT_TOP ) {
+                    ++ntop;
+                }
+            }
+        }
+
+        if ( use_csv ) {
+            fprintf( out, "[%02d] irq,%lu,%d,%lu,%lu,%llu,%llu,%s,%lu,%s,%lu\n",
+                     thread_id, interval, cpu, irq_total, softirq_total,
+                     tick_delta( before->irq_ticks[cpu],
+                                 after->irq_ticks[cpu] ),
+                     tick_delta( before->softirq_ticks[cpu],
+                                 after->softirq_ticks[cpu] ),
+                     ntop ? after->name[top[0]] : "-",
+                     ntop ? irq_delta[top[0]] : 0,
+                     top_softirq >= 0 ? after->softirq_name[top_softirq] : "-",
+                     top_softirq >= 0 ? softirq_delta[top_softirq] : 0 );
+            continue;
+        }
+
+        fprintf( out, "[%02d]   cpu%-3d irqs: %8lu  softirqs: %8lu  "
+                 "irq/softirq ticks: %llu/%llu\n",
+                 thread_id, cpu, irq_total, softirq_total,
+                 tick_delta( before->irq_ticks[cpu],
+                             after->irq_ticks[cpu] ),
+                 tick_delta( before->softirq_ticks[cpu],
+                             after->softirq_ticks[cpu] ) );
+        for ( i = 0; i < ntop; ++i ) {
+            fprintf( out, "[%02d]     irq %-8s %8lu  %s\n", thread_id,
+                     after->name[top[i]], irq_delta[top[i]],
+                     after->desc[top[i]] );
+        }
+        for ( i = 0; i < after->nsoftirqs; ++i ) {
+            if ( softirq_delta[i] == 0 ) {
+                continue;
+            }
+            fprintf( out, "[%02d]     softirq %-8s %4lu\n", thread_id,
+                     after->softirq_name[i], softirq_delta[i] );
+        }
+    }
+    free( irq_delta );
+}
@@ -0,0 +1,46 @@
+#ifndef IRQSTAT_H
+#define IRQSTAT_H
+
+#include <stdio.h>
+#include <sched.h>
+
+#define IRQ_INIT_LINES  256
+#define IRQ_MAX_SOFTIRQ 16
+#define IRQ_NAME_LEN    16
+#define IRQ_DESC_LEN    64
+#define IRQ_REPORT_TOP  5
+
+/*
+ * Per CPU snapshot of /proc/interrupts, /proc/softirqs and the irq/softirq
+ * columns of /proc/stat.  Counters are stored row-major, indexed by
+ * [line * ncpus + cpu] where cpu is the kernel CPU number.  The interrupt
+ * table grows to fit hosts with many MSI-X vectors.
+ */
+struct irqstat
+{
+    int ncpus;
+
+    int nlines;
+    int maxlines;
+    char (*name)[IRQ_NAME_LEN];
+    char (*desc)[IRQ_DESC_LEN];
+    unsigned long *irqs;
+
+    int nsoftirqs;
+    char softirq_name[IRQ_MAX_SOFTIRQ][IRQ_NAME_LEN];
+    unsigned long *softirqs;
+
+    /* USER_HZ ticks spent servicing hard and soft interrupts */
+    unsigned long long *irq_ticks;
+    unsigned long long *softirq_ticks;
+};
+
+struct irqstat *irqstat_alloc( void );
+void irqstat_free( struct irqstat *stat );
+int irqstat_snapshot( struct irqstat *stat );
+void irqstat_csv_header( FILE *out );
+void irqstat_report( FILE *out, int thread_id, unsigned long interval,
+                     int use_csv, cpu_set_t *cpus,
+                     struct irqstat *before, struct irqstat *after );
+
+#endif /* IRQSTAT_H */
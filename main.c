@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <unistd.h>
 #include <syscall.h>
@@ -9,26 +10,14 @@
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <sched.h>
+#include <errno.h>
 
-#define MAX_ARGS    2
-#define NUM_TESTS   1000
+#include "irqstat.h"
+#include "sweep.h"
+#include "thread_test.h"
 
-struct thread_args
-{
-    int thread_id;
-    int use_csv;
-    int use_abstime;
-    int use_timers;
-    clockid_t clock_id; 
-
-    /* for signals */
-    struct timespec prev;
-    unsigned long min;
-    unsigned long max;
-    unsigned long avg;
-    unsigned long sum;
-    unsigned long overrun;
-};
+#define MAX_ARGS    2
 
 void
 timespec_add( struct timespec *result,
@@ -84,6 +73,55 @@ sighand( int signo, siginfo_t *siginfo, void *ucntxt )
     //fprintf( stdout, "[%02d] Signal received.\n", args->thread_id );
 }
 
+static void
+record_result( struct thread_args *args, unsigned long interval,
+               unsigned long avg, unsigned long min, unsigned long max,
+               unsigned long overrun )
+{
+    struct interval_result *result;
+
+    if ( args->num_results >= NUM_INTERVALS ) {
+        return;
+    }
+    result = &args->results[args->num_results++];
+    result->interval = interval;
+    result->avg = avg;
+    result->min = min;
+    result->max = max;
+    result->overrun = overrun;
+}
+
+static void
+sync_irqstat( struct irq_sync *sync, int after )
+{
+    if ( pthread_barrier_wait( &sync->barrier ) ==
+         PTHREAD_BARRIER_SERIAL_THREAD ) {
+        if ( !after ) {
+            sync->ok = ( irqstat_snapshot( sync->before ) == 0 );
+        }
+        else if ( sync->ok ) {
+            sync->ok = ( irqstat_snapshot( sync->after ) == 0 );
+        }
+    }
+    pthread_barrier_wait( &sync->barrier );
+}
+
+static void
+report_irqstat( struct thread_args *args, unsigned long interval,
+                cpu_set_t *cpus )
+{
+    struct irq_sync *sync = args->irq_sync;
+
+    sync_irqstat( sync, 1 );
+    if ( !sync->ok ) {
+        fprintf( stderr, "[%02d] Unable to read interrupt statistics, "
+                 "skipping interval %lu.\n", args->thread_id, interval );
+        return;
+    }
+    irqstat_report( stdout, args->thread_id, interval, args->use_csv, cpus,
+                    sync->before, sync->after );
+}
+
 void
 timer_test( struct thread_args *args )
 {
@@ -91,6 +129,7 @@ timer_test( struct thread_args *args )
     struct itimerspec its;
     struct sigaction actions;
     timer_t timer_id;
+    cpu_set_t cpus;
 
     /* Setup timer event */
     evp.sigev_notify = SIGEV_THREAD_ID;
@@ -117,11 +156,13 @@ timer_test( struct thread_args *args )
         exit( -1 );
     }
 
-    if ( !args->use_csv ) {
+    if ( !args->use_csv && !args->quiet ) {
         fprintf( stdout, "[%02d] |  Stat  |   Avg   |   Min   |   Max   |"
                 "  Diff  |  Range  | Overruns |\n", args->thread_id );
     }
 
+    args->num_results = 0;
+
     its.it_interval.tv_sec = 0;
     its.it_interval.tv_nsec = 1;
     while ( its.it_interval.tv_nsec < 100000000 ) {
@@ -130,6 +171,11 @@ timer_test( struct thread_args *args )
         args->avg = args->max = args->sum = args->overrun = 0;
         args->min = ULONG_MAX;
 
+        if ( args->use_irqstat ) {
+            CPU_ZERO( &cpus );
+            sync_irqstat( args->irq_sync, 0 );
+        }
+
         /* turn on timer */
         its.it_value = its.it_interval;
         timer_settime( timer_id, 0, &its, NULL );
@@ -142,17 +188,21 @@ timer_test( struct thread_args *args )
                                  &remain );
                 total_sleep = remain;
             } while ( remain.tv_sec > 0 && remain.tv_nsec > 0 );
+            if ( args->use_irqstat ) {
+                CPU_SET( sched_getcpu(), &cpus );
+            }
         }
-        if ( args->use_csv ) {
-            args->avg = args->sum / NUM_TESTS;
+        args->avg = args->sum / NUM_TESTS;
+        record_result( args, its.it_interval.tv_nsec, args->avg, args->min,
+                       args->max, args->overrun );
+        if ( args->use_csv && !args->quiet ) {
             fprintf( stdout, "[%02d] %lu,%lu,%lu,%lu,%lu,%lu,%lu\n", 
                      args->thread_id, its.it_interval.tv_nsec, 
                      args->avg, args->min, args->max, 
                      args->avg - its.it_interval.tv_nsec, 
                      args->max - args->min, args->overrun );
         }
-        else {
-            args->avg = args->sum / NUM_TESTS;
+        else if ( !args->quiet ) {
             fprintf( stdout, "[%02d] %9lu  %8lu  %8lu  %8lu  %7lu  %8lu  "
                      "%9lu\n", 
                      args->thread_id, its.it_interval.tv_nsec, 
@@ -164,14 +214,22 @@ timer_test( struct thread_args *args )
         /* turn off timer */
         its.it_value.tv_nsec = 0;
         timer_settime( timer_id, 0, &its, NULL );
+
+        /* read /proc with the timer off so the reads are not interrupted */
+        if ( args->use_irqstat ) {
+            report_irqstat( args, its.it_interval.tv_nsec, &cpus );
+        }
         its.it_interval.tv_nsec *= 10;
     }
+
+    timer_delete( timer_id );
 }
 
 void
 sleep_test( struct thread_args *args )
 {
     struct timespec sleep, before, after, diff;
+    cpu_set_t cpus;
     int i;
     unsigned long adjust, avg, min, max, sum = 0;
     sleep.tv_sec = 0;
@@ -186,17 +244,24 @@ sleep_test( struct thread_args *args )
         sum += diff.tv_nsec;
     }
     adjust = ( sum / NUM_TESTS ) << 1; 
-    fprintf( stdout, "[%02d] Adjustment for clock_gettime (x2): %9lu.\n", 
-             args->thread_id, adjust );
+    if ( !args->quiet ) {
+        fprintf( stdout, "[%02d] Adjustment for clock_gettime (x2): %9lu.\n", 
+                 args->thread_id, adjust );
+    }
 
-    if ( !args->use_csv ) {
+    if ( !args->use_csv && !args->quiet ) {
         fprintf( stdout, "[%02d] |  Stat  |   Avg   |   Min   |   Max   |"
                 "  Diff  |  Range  |\n", args->thread_id );
     }
 
+    args->num_results = 0;
     while ( sleep.tv_nsec < 100000000 ) {
         avg = sum = max = 0;
         min = ULONG_MAX;
+        if ( args->use_irqstat ) {
+            CPU_ZERO( &cpus );
+            sync_irqstat( args->irq_sync, 0 );
+        }
         for ( i = 0; i < NUM_TESTS; ++i ) {
             if ( !args->use_abstime ) {
                 clock_gettime( args->clock_id, &before );
@@ -211,6 +276,9 @@ sleep_test( struct thread_args *args )
                                  &wakeup_time, NULL );
                 clock_gettime( args->clock_id, &after );
             }
+            if ( args->use_irqstat ) {
+                CPU_SET( sched_getcpu(), &cpus );
+            }
             timespec_subtract( &diff, &after, &before );
             sum += diff.tv_nsec - adjust;
             if ( diff.tv_nsec - adjust < min ) {
@@ -220,37 +288,46 @@ sleep_test( struct thread_args *args )
                 max = diff.tv_nsec - adjust;
             }
         }
-        if ( args->use_csv ) {
-            avg = sum / NUM_TESTS;
+        avg = sum / NUM_TESTS;
+        record_result( args, sleep.tv_nsec, avg, min, max, 0 );
+        if ( args->use_csv && !args->quiet ) {
             fprintf( stdout, "[%02d] %lu,%lu,%lu,%lu,%lu,%lu\n", 
                      args->thread_id, sleep.tv_nsec, 
                      avg, min, max, avg - sleep.tv_nsec, 
                      max - min );
         }
-        else {
-            avg = sum / NUM_TESTS;
+        else if ( !args->quiet ) {
             fprintf( stdout, "[%02d] %9lu  %8lu  %8lu  %8lu  %7lu  %8lu\n", 
                      args->thread_id, sleep.tv_nsec, 
                      avg, min, max, avg - sleep.tv_nsec,
                      max - min );
         }
+        if ( args->use_irqstat ) {
+            report_irqstat( args, sleep.tv_nsec, &cpus );
+        }
         sleep.tv_nsec *= 10;
     }
 
 }
 
-void *
-thread_test( void *targs )
+void
+run_test( struct thread_args *args )
 {
-    struct thread_args *args = (struct thread_args *) targs;
-
-    fprintf( stdout, "[%02d] Thread started.\n", args->thread_id );
     if ( args->use_timers ) {
         timer_test( args );
     }
     else {
         sleep_test( args );
     }
+}
+
+void *
+thread_test( void *targs )
+{
+    struct thread_args *args = (struct thread_args *) targs;
+
+    fprintf( stdout, "[%02d] Thread started.\n", args->thread_id );
+    run_test( args );
     fprintf( stdout, "[%02d] Thread exiting.\n", args->thread_id );
     free( targs );
     pthread_exit( NULL );
@@ -269,10 +346,27 @@ print_clockres( clockid_t clock_id )
     return 0;
 }
 
+int
+parse_count( const char *arg, int opt )
+{
+    char *end;
+    long val;
+
+    errno = 0;
+    val = strtol( arg, &end, 10 );
+    if ( errno != 0 || end == arg || *end != '\0' || val < 1 ||
+         val > INT_MAX ) {
+        fprintf( stderr, "Invalid value '%s' for '-%c'.\n", arg, opt );
+        exit( -1 );
+    }
+    return (int) val;
+}
+
 void 
 print_usage( const char *basename ) 
 {
-    fprintf( stderr, "Usage: %s [-f|-r|-o] [-t] [-m] [-a] [-p priority] [-n threads] [-c]\n", 
+    fprintf( stderr, "Usage: %s [-f|-r|-o] [-t] [-m] [-a] [-p priority] [-n threads] [-c] [-i]\n"
+             "       [-s repeats] [-j jobs] [-k clocks] [-w modes]\n", 
              basename );
     fprintf( stderr, "Options:\n" );
     fprintf( stderr, "    -f  use FIFO scheduling\n" );
@@ -284,6 +378,21 @@ print_usage( const char *basename )
     fprintf( stderr, "    -n  number of threads to run\n" );
     fprintf( stderr, "    -p  scheduling priority (FIFO or RR)\n" );
     fprintf( stderr, "    -c  print CSV format\n" );
+    fprintf( stderr, "    -i  report interrupts/softirqs per interval\n" );
+    fprintf( stderr, "        (CSV: irq,interval,cpu,irqs,softirqs,irq_ticks,"
+             "softirq_ticks,\n"
+             "         top_irq,top_irq_count,top_softirq,"
+             "top_softirq_count)\n" );
+    fprintf( stderr, "    -s  sweep policy/clock/mode combinations, at least "
+             "2 repeats each,\n"
+             "        and compare; -f/-r/-o restrict the policy, "
+             "-t/-m/-a/-i are not allowed\n" );
+    fprintf( stderr, "    -j  number of sweep jobs run concurrently on "
+             "disjoint CPUs\n" );
+    fprintf( stderr, "    -k  sweep clocks: realtime,monotonic "
+             "(default both)\n" );
+    fprintf( stderr, "    -w  sweep modes: sleep,abstime,timer "
+             "(default sleep,abstime)\n" );
 }
 
 int 
@@ -292,19 +401,23 @@ main( int argc, char* argv[] )
     pthread_t *threads;
     pthread_attr_t attr;
     struct sched_param param;
+    struct irq_sync irq_sync;
     clockid_t clock_id = CLOCK_REALTIME;
     int num_threads = 1;
-    int use_sched = 0, policy;
+    int use_sched = 0, policy = SCHED_OTHER;
     int use_csv = 0;
     int use_abstime = 0;
     int use_timers = 0;
+    int use_irqstat = 0;
+    int repeats = 0, jobs = 0;
+    int sweep_clocks = 0, sweep_modes = 0;
     int rc, i, c;
     void *status;
 
     memset( &param, 0, sizeof( param ) );
     opterr = 0;
     optind = 1;
-    while ( ( c = getopt( argc, argv, "cfortmap:n:" ) ) != -1 ) {
+    while ( ( c = getopt( argc, argv, "cfortmaip:n:s:j:k:w:" ) ) != -1 ) {
         switch ( c )
         {
             case 'f':
@@ -343,6 +456,10 @@ main( int argc, char* argv[] )
                 use_abstime = 1;
                 fprintf( stdout, "Using TIMER_ABSTIME.\n" );
                 break;
+            case 'i':
+                use_irqstat = 1;
+                fprintf( stdout, "Reporting interrupts per interval.\n" );
+                break;
             case 'p':
                 param.sched_priority = atoi( optarg );
                 fprintf( stdout, "Using priority %d.\n", param.sched_priority );
@@ -350,8 +467,29 @@ main( int argc, char* argv[] )
             case 'n':
                 num_threads = atoi( optarg );
                 break;
+            case 's':
+                repeats = parse_count( optarg, c );
+                break;
+            case 'j':
+                jobs = parse_count( optarg, c );
+                break;
+            case 'k':
+                sweep_clocks = sweep_parse_clocks( optarg );
+                if ( sweep_clocks < 0 ) {
+                    fprintf( stderr, "Invalid clock list '%s'.\n", optarg );
+                    exit( -1 );
+                }
+                break;
+            case 'w':
+                sweep_modes = sweep_parse_modes( optarg );
+                if ( sweep_modes < 0 ) {
+                    fprintf( stderr, "Invalid mode list '%s'.\n", optarg );
+                    exit( -1 );
+                }
+                break;
             case '?':
-                if ( optopt == 'p' || optopt == 'n' ) {
+                if ( optopt == 'p' || optopt == 'n' || optopt == 's' ||
+                     optopt == 'j' || optopt == 'k' || optopt == 'w' ) {
                     print_usage( argv[0] );
                     fprintf( stderr, "Missing value for '-%c'.\n", optopt );
                     exit ( -1 );
@@ -363,12 +501,36 @@ main( int argc, char* argv[] )
         }
     }
 
-    if ( !use_sched && param.sched_priority ) {
+    if ( num_threads < 1 ) {
+        fprintf( stderr, "Threads must be positive.\n" );
+        exit( -1 );
+    }
+    else if ( !repeats && ( jobs || sweep_clocks || sweep_modes ) ) {
+        fprintf( stderr, "-j, -k and -w require -s.\n" );
+        exit( -1 );
+    }
+    else if ( repeats == 1 ) {
+        fprintf( stderr, "-s needs at least 2 repeats for a confidence "
+                 "interval.\n" );
+        exit( -1 );
+    }
+    else if ( repeats && use_irqstat ) {
+        fprintf( stderr, "-i cannot be combined with -s.\n" );
+        exit( -1 );
+    }
+    else if ( repeats && ( use_timers || use_abstime ||
+                           clock_id != CLOCK_REALTIME ) ) {
+        fprintf( stderr, "Use -k and -w to select clocks and modes "
+                 "with -s.\n" );
+        exit( -1 );
+    }
+    /* the sweep picks its own priority for FIFO and RR */
+    else if ( !repeats && !use_sched && param.sched_priority ) {
         fprintf( stderr, "Must select a scheduling policy to "
                  "specify a priority.\n" );
         exit( -1 );
     }
-    else if ( use_sched && !param.sched_priority ) {
+    else if ( !repeats && use_sched && !param.sched_priority ) {
         fprintf( stderr, "Must specify a priority for FIFO or RR.\n" );
         exit( -1 );
     }
@@ -377,6 +539,47 @@ main( int argc, char* argv[] )
         exit( -1 );
     }
 
+    memset( &irq_sync, 0, sizeof( irq_sync ) );
+    if ( use_irqstat ) {
+        irq_sync.before = irqstat_alloc();
+        irq_sync.after = irqstat_alloc();
+        if ( irq_sync.before == NULL || irq_sync.after == NULL ) {
+            fprintf( stderr, "irqstat malloc failed.\n" );
+            exit( -1 );
+        }
+        if ( irqstat_snapshot( irq_sync.before ) != 0 ) {
+            fprintf( stderr, "Unable to read interrupt statistics "
+                     "from /proc.\n" );
+            exit( -1 );
+        }
+        pthread_barrier_init( &irq_sync.barrier, NULL, num_threads );
+        if ( use_csv ) {
+            irqstat_csv_header( stdout );
+        }
+    }
+
+    if ( repeats ) {
+        struct sweep_options opts;
+        memset( &opts, 0, sizeof( opts ) );
+        opts.repeats = repeats;
+        opts.jobs = jobs ? jobs : 1;
+        opts.num_threads = num_threads;
+        opts.use_csv = use_csv;
+        opts.use_sched = use_sched;
+        opts.policy = policy;
+        opts.clocks = sweep_clocks ? sweep_clocks :
+                      SWEEP_CLOCK_REALTIME | SWEEP_CLOCK_MONOTONIC;
+        /* timers start at 1ns and can flood the process, so opt in */
+        opts.modes = sweep_modes ? sweep_modes :
+                     SWEEP_MODE_SLEEP | SWEEP_MODE_ABSTIME;
+        opts.priority = param.sched_priority;
+        if ( run_sweep( &opts ) != 0 ) {
+            exit( -1 );
+        }
+        fprintf( stdout, "Done.\n" );
+        return 0;
+    }
+
     threads = (pthread_t *) malloc( sizeof(pthread_t) * num_threads );
     if ( threads == NULL ) {
         fprintf( stderr, "pthread_t malloc failed.\n" );
@@ -408,13 +611,19 @@ main( int argc, char* argv[] )
     
     fprintf( stdout, "Starting %d threads.\n", num_threads );
     for ( i = 0; i < num_threads; ++i ) {
-        struct thread_args *args = (struct thread_args *)malloc( 
-                sizeof( struct thread_args ) );
+        struct thread_args *args = (struct thread_args *)calloc( 
+                1, sizeof( struct thread_args ) );
+        if ( args == NULL ) {
+            fprintf( stderr, "[%02d] thread_args malloc failed.\n", i );
+            exit( -1 );
+        }
         args->thread_id = i;
         args->use_csv = use_csv;
         args->clock_id = clock_id;
         args->use_abstime = use_abstime;
         args->use_timers = use_timers;
+        args->use_irqstat = use_irqstat;
+        args->irq_sync = &irq_sync;
         clock_gettime( clock_id, &args->prev );
         rc = pthread_create( &threads[i], &attr, thread_test, args );
         if ( rc ) {
@@ -433,6 +642,11 @@ main( int argc, char* argv[] )
         }
     }
     free( threads );
+    if ( use_irqstat ) {
+        pthread_barrier_destroy( &irq_sync.barrier );
+        irqstat_free( irq_sync.before );
+        irqstat_free( irq_sync.after );
+    }
     fprintf( stdout, "Done.\n" );
     return 0;
 }
@@ -0,0 +1,539 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "sweep.h"
+#include "thread_test.h"
+
+#define SWEEP_MAX_CONFIGS   18
+#define SWEEP_NAME_LEN      32
+
+struct sweep_config
+{
+    char name[SWEEP_NAME_LEN];
+    int policy;
+    clockid_t clock_id;
+    int use_abstime;
+    int use_timers;
+    int failed;
+
+    /*
+     * one row of NUM_INTERVALS values per repeat; threads of a repeat run
+     * side by side, so they are folded into a single sample
+     */
+    int nsamples;
+    double *diff;
+    double *max;
+    unsigned long interval[NUM_INTERVALS];
+};
+
+struct sweep_state
+{
+    struct sweep_options *opts;
+    struct sweep_config configs[SWEEP_MAX_CONFIGS];
+    int num_configs;
+
+    /* runs are handed out repeat by repeat so drift hits every config */
+    pthread_mutex_t lock;
+    int next_run;
+    int num_runs;
+};
+
+struct sweep_job
+{
+    int job_id;
+    cpu_set_t cpus;
+    struct sweep_state *state;
+};
+
+/* two sided 95% critical values of Student's t, 1..30 degrees of freedom */
+static const double t_table[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double
+t_critical( int df )
+{
+    if ( df < 1 ) {
+        return 0.0;
+    }
+    if ( df <= (int)( sizeof( t_table ) / sizeof( t_table[0] ) ) ) {
+        return t_table[df - 1];
+    }
+    return 1.960;
+}
+
+/*
+ * Mean and 95% confidence half-width of one interval's samples.  The
+ * half-width is negative when there are too few samples to estimate it.
+ */
+static void
+summarize( double *samples, int nsamples, int interval,
+           double *mean, double *ci )
+{
+    double sum = 0.0, sq = 0.0;
+    int i;
+
+    *mean = 0.0;
+    *ci = -1.0;
+    if ( nsamples == 0 ) {
+        return;
+    }
+    for ( i = 0; i < nsamples; ++i ) {
+        sum += samples[i * NUM_INTERVALS + interval];
+    }
+    *mean = sum / nsamples;
+    if ( nsamples < 2 ) {
+        return;
+    }
+    for ( i = 0; i < nsamples; ++i ) {
+        double d = samples[i * NUM_INTERVALS + interval] - *mean;
+        sq += d * d;
+    }
+    *ci = t_critical( nsamples - 1 ) * sqrt( sq / ( nsamples - 1 ) ) /
+          sqrt( nsamples );
+}
+
+static void
+format_ci( char *buf, size_t len, const char *fmt, double ci )
+{
+    if ( ci < 0.0 ) {
+        snprintf( buf, len, "n/a" );
+    }
+    else {
+        snprintf( buf, len, fmt, ci );
+    }
+}
+
+/*
+ * Parse a comma separated list of names into a mask where names[i] maps
+ * to bit i.  Returns -1 on an unknown or empty name.
+ */
+static int
+parse_list( const char *list, const char *names[], int count )
+{
+    char *copy, *item, *save = NULL;
+    int mask = 0, i;
+
+    copy = strdup( list );
+    if ( copy == NULL ) {
+        return -1;
+    }
+    for ( item = strtok_r( copy, ",", &save ); item != NULL;
+          item = strtok_r( NULL, ",", &save ) ) {
+        for ( i = 0; i < count; ++i ) {
+            if ( strcasecmp( item, names[i] ) == 0 ) {
+                break;
+            }
+        }
+        if ( i == count ) {
+            free( copy );
+            return -1;
+        }
+        mask |= 1 << i;
+    }
+    free( copy );
+    return mask ? mask : -1;
+}
+
+int
+sweep_parse_clocks( const char *list )
+{
+    static const char *names[] = { "realtime", "monotonic" };
+    return parse_list( list, names, 2 );
+}
+
+int
+sweep_parse_modes( const char *list )
+{
+    static const char *names[] = { "sleep", "abstime", "timer" };
+    return parse_list( list, names, 3 );
+}
+
+static const char *
+policy_name( int policy )
+{
+    switch ( policy )
+    {
+        case SCHED_FIFO:
+            return "FIFO";
+        case SCHED_RR:
+            return "RR";
+        default:
+            return "OTHER";
+    }
+}
+
+static int
+build_configs( struct sweep_state *state )
+{
+    static const int policies[] = { SCHED_OTHER, SCHED_FIFO, SCHED_RR };
+    static const clockid_t clocks[] = { CLOCK_REALTIME, CLOCK_MONOTONIC };
+    static const char *modes[] = { "sleep", "abstime", "timer" };
+    static const int clock_bits[] = {
+        SWEEP_CLOCK_REALTIME, SWEEP_CLOCK_MONOTONIC
+    };
+    static const int mode_bits[] = {
+        SWEEP_MODE_SLEEP, SWEEP_MODE_ABSTIME, SWEEP_MODE_TIMER
+    };
+    struct sweep_options *opts = state->opts;
+    int p, c, m, capacity;
+
+    capacity = opts->repeats * NUM_INTERVALS;
+
+    state->num_configs = 0;
+    for ( p = 0; p < 3; ++p ) {
+        if ( opts->use_sched && policies[p] != opts->policy ) {
+            continue;
+        }
+        for ( c = 0; c < 2; ++c ) {
+            if ( !( opts->clocks & clock_bits[c] ) ) {
+                continue;
+            }
+            for ( m = 0; m < 3; ++m ) {
+                struct sweep_config *config;
+                if ( !( opts->modes & mode_bits[m] ) ) {
+                    continue;
+                }
+                config =
+                    &state->configs[state->num_configs++];
+                memset( config, 0, sizeof( *config ) );
+                snprintf( config->name, SWEEP_NAME_LEN, "%s/%s/%s",
+                          policy_name( policies[p] ),
+                          clocks[c] == CLOCK_MONOTONIC ?
+                              "MONOTONIC" : "REALTIME",
+                          modes[m] );
+                config->policy = policies[p];
+                config->clock_id = clocks[c];
+                config->use_abstime = ( m == 1 );
+                config->use_timers = ( m == 2 );
+                config->diff = (double *) malloc( sizeof( double ) *
+                                                  capacity );
+                config->max = (double *) malloc( sizeof( double ) *
+                                                 capacity );
+                if ( config->diff == NULL || config->max == NULL ) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void *
+sweep_thread( void *targs )
+{
+    run_test( (struct thread_args *) targs );
+    return NULL;
+}
+
+/*
+ * Run one repeat of a configuration on the job's cores.  Returns 0 on
+ * success, or the pthread_create error if the policy cannot be used.
+ */
+static int
+run_config( struct sweep_job *job, struct sweep_config *config, int repeat,
+            pthread_t *threads, struct thread_args *args )
+{
+    struct sweep_state *state = job->state;
+    struct sweep_options *opts = state->opts;
+    struct sched_param param;
+    pthread_attr_t attr;
+    int rc, i, created, k;
+    void *status;
+
+    memset( &param, 0, sizeof( param ) );
+    if ( config->policy != SCHED_OTHER ) {
+        param.sched_priority = opts->priority ? opts->priority :
+                               sched_get_priority_min( config->policy );
+    }
+
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
+    pthread_attr_setaffinity_np( &attr, sizeof( cpu_set_t ), &job->cpus );
+    pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+    pthread_attr_setschedpolicy( &attr, config->policy );
+    pthread_attr_setschedparam( &attr, &param );
+
+    if ( !opts->use_csv ) {
+        fprintf( stdout, "Job %d: %s, repeat %d/%d.\n", job->job_id,
+                 config->name, repeat + 1, opts->repeats );
+    }
+
+    rc = 0;
+    for ( created = 0; created < opts->num_threads; ++created ) {
+        memset( &args[created], 0, sizeof( struct thread_args ) );
+        args[created].thread_id = job->job_id * opts->num_threads + created;
+        args[created].use_csv = opts->use_csv;
+        args[created].use_abstime = config->use_abstime;
+        args[created].use_timers = config->use_timers;
+        args[created].clock_id = config->clock_id;
+        args[created].quiet = 1;
+        clock_gettime( config->clock_id, &args[created].prev );
+        rc = pthread_create( &threads[created], &attr,
+                             sweep_thread, &args[created] );
+        if ( rc ) {
+            break;
+        }
+    }
+    pthread_attr_destroy( &attr );
+
+    for ( i = 0; i < created; ++i ) {
+        int jrc = pthread_join( threads[i], &status );
+        if ( jrc ) {
+            fprintf( stderr, "[%02d] pthread_join failed: %s.\n",
+                     args[i].thread_id, strerror( jrc ) );
+            exit( -1 );
+        }
+    }
+    if ( rc ) {
+        return rc;
+    }
+
+    /* the repeat's sample is the thread mean of Diff and the worst Max */
+    pthread_mutex_lock( &state->lock );
+    for ( k = 0; k < NUM_INTERVALS; ++k ) {
+        double diff = 0.0, max = 0.0;
+        for ( i = 0; i < created; ++i ) {
+            struct interval_result *result = &args[i].results[k];
+            diff += (double) result->avg - (double) result->interval;
+            if ( (double) result->max > max ) {
+                max = (double) result->max;
+            }
+        }
+        config->interval[k] = args[0].results[k].interval;
+        config->diff[config->nsamples * NUM_INTERVALS + k] = diff / created;
+        config->max[config->nsamples * NUM_INTERVALS + k] = max;
+    }
+    config->nsamples++;
+    pthread_mutex_unlock( &state->lock );
+    return 0;
+}
+
+static void *
+sweep_job( void *jargs )
+{
+    struct sweep_job *job = (struct sweep_job *) jargs;
+    struct sweep_state *state = job->state;
+    int num_threads = state->opts->num_threads;
+    pthread_t *threads;
+    struct thread_args *args;
+
+    threads = (pthread_t *) malloc( sizeof( pthread_t ) * num_threads );
+    args = (struct thread_args *) malloc( sizeof( struct thread_args ) *
+                                          num_threads );
+    if ( threads == NULL || args == NULL ) {
+        fprintf( stderr, "Job %d: malloc failed.\n", job->job_id );
+        exit( -1 );
+    }
+
+    for ( ;; ) {
+        struct sweep_config *config;
+        int run, failed, rc;
+
+        pthread_mutex_lock( &state->lock );
+        if ( state->next_run >= state->num_runs ) {
+            pthread_mutex_unlock( &state->lock );
+            break;
+        }
+        run = state->next_run++;
+        config = &state->configs[run % state->num_configs];
+        failed = config->failed;
+        pthread_mutex_unlock( &state->lock );
+
+        if ( failed ) {
+            continue;
+        }
+        rc = run_config( job, config, run / state->num_configs, threads,
+                         args );
+        if ( rc == EPERM || rc == EINVAL ) {
+            pthread_mutex_lock( &state->lock );
+            if ( !config->failed ) {
+                fprintf( stderr, "%s: pthread_create failed: %s, "
+                         "skipping.\n", config->name, strerror( rc ) );
+            }
+            config->failed = 1;
+            pthread_mutex_unlock( &state->lock );
+        }
+        else if ( rc ) {
+            fprintf( stderr, "Job %d: pthread_create failed: %s.\n",
+                     job->job_id, strerror( rc ) );
+            exit( -1 );
+        }
+    }
+
+    free( threads );
+    free( args );
+    return NULL;
+}
+
+/*
+ * Split the CPUs this process may run on into 'jobs' disjoint sets so
+ * concurrent configurations do not compete for the same cores.
+ */
+static int
+assign_cpus( struct sweep_job *jobs, int num_jobs )
+{
+    cpu_set_t allowed;
+    int cpus[CPU_SETSIZE], ncpus = 0, cpu, j, i;
+
+    if ( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 ) {
+        perror( "sched_getaffinity failed" );
+        return -1;
+    }
+    for ( cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+        if ( CPU_ISSET( cpu, &allowed ) ) {
+            cpus[ncpus++] = cpu;
+        }
+    }
+    if ( num_jobs > ncpus ) {
+        fprintf( stderr, "Cannot run %d jobs on %d CPUs.\n", num_jobs,
+                 ncpus );
+        return -1;
+    }
+    for ( j = 0; j < num_jobs; ++j ) {
+        CPU_ZERO( &jobs[j].cpus );
+        for ( i = j * ncpus / num_jobs; i < ( j + 1 ) * ncpus / num_jobs;
+              ++i ) {
+            CPU_SET( cpus[i], &jobs[j].cpus );
+        }
+    }
+    return 0;
+}
+
+static void
+print_report( struct sweep_state *state )
+{
+    struct sweep_options *opts = state->opts;
+    int c, k;
+
+    if ( opts->use_csv ) {
+        fprintf( stdout, "config,interval,samples,diff,diff_ci95,"
+                 "max,max_ci95\n" );
+        for ( k = 0; k < NUM_INTERVALS; ++k ) {
+            for ( c = 0; c < state->num_configs; ++c ) {
+                struct sweep_config *config = &state->configs[c];
+                double diff, diff_ci, max, max_ci;
+                char diff_buf[32], max_buf[32];
+                if ( config->nsamples == 0 ) {
+                    continue;
+                }
+                summarize( config->diff, config->nsamples, k,
+                           &diff, &diff_ci );
+                summarize( config->max, config->nsamples, k, &max, &max_ci );
+                format_ci( diff_buf, sizeof( diff_buf ), "%.1f", diff_ci );
+                format_ci( max_buf, sizeof( max_buf ), "%.1f", max_ci );
+                fprintf( stdout, "%s,%lu,%d,%.1f,%s,%.1f,%s\n",
+                         config->name, config->interval[k],
+                         config->nsamples, diff, diff_buf, max, max_buf );
+            }
+        }
+        return;
+    }
+
+    fprintf( stdout, "Comparison of %d configurations, %d repeats x %d "
+             "threads, mean +/- 95%% confidence interval (ns).\n"
+             "Each repeat is one sample: Diff is averaged and Max is the "
+             "worst across its threads.\n",
+             state->num_configs, opts->repeats, opts->num_threads );
+    for ( k = 0; k < NUM_INTERVALS; ++k ) {
+        unsigned long interval = 0;
+
+        for ( c = 0; c < state->num_configs && !interval; ++c ) {
+            interval = state->configs[c].interval[k];
+        }
+        fprintf( stdout, "\nInterval %lu ns\n", interval );
+        fprintf( stdout, "  %-23s %3s  %10s  %8s  %10s  %8s\n",
+                 "Configuration", "N", "Diff", "+/-", "Max", "+/-" );
+        for ( c = 0; c < state->num_configs; ++c ) {
+            struct sweep_config *config = &state->configs[c];
+            double diff, diff_ci, max, max_ci;
+            char diff_buf[32], max_buf[32];
+            if ( config->nsamples == 0 ) {
+                fprintf( stdout, "  %-23s   0  skipped\n", config->name );
+                continue;
+            }
+            summarize( config->diff, config->nsamples, k, &diff, &diff_ci );
+            summarize( config->max, config->nsamples, k, &max, &max_ci );
+            format_ci( diff_buf, sizeof( diff_buf ), "%.0f", diff_ci );
+            format_ci( max_buf, sizeof( max_buf ), "%.0f", max_ci );
+            fprintf( stdout, "  %-23s %3d  %10.0f  %8s  %10.0f  %8s\n",
+                     config->name, config->nsamples, diff, diff_buf,
+                     max, max_buf );
+        }
+    }
+}
+
+int
+run_sweep( struct sweep_options *opts )
+{
+    struct sweep_state state;
+    struct sweep_job *jobs;
+    pthread_t *job_threads;
+    int rc, j, c;
+    void *status;
+
+    memset( &state, 0, sizeof( state ) );
+    state.opts = opts;
+    if ( build_configs( &state ) != 0 ) {
+        fprintf( stderr, "Sweep malloc failed.\n" );
+        return -1;
+    }
+    state.num_runs = state.num_configs * opts->repeats;
+    pthread_mutex_init( &state.lock, NULL );
+
+    jobs = (struct sweep_job *) malloc( sizeof( struct sweep_job ) *
+                                        opts->jobs );
+    job_threads = (pthread_t *) malloc( sizeof( pthread_t ) * opts->jobs );
+    if ( jobs == NULL || job_threads == NULL ) {
+        fprintf( stderr, "Sweep malloc failed.\n" );
+        return -1;
+    }
+    if ( assign_cpus( jobs, opts->jobs ) != 0 ) {
+        return -1;
+    }
+
+    if ( !opts->use_csv ) {
+        fprintf( stdout, "Sweeping %d configurations x %d repeats "
+                 "with %d jobs.\n", state.num_configs, opts->repeats,
+                 opts->jobs );
+    }
+    for ( j = 0; j < opts->jobs; ++j ) {
+        jobs[j].job_id = j;
+        jobs[j].state = &state;
+        rc = pthread_create( &job_threads[j], NULL, sweep_job, &jobs[j] );
+        if ( rc ) {
+            fprintf( stderr, "Job %d: pthread_create failed: %s.\n",
+                     j, strerror( rc ) );
+            exit( -1 );
+        }
+    }
+    for ( j = 0; j < opts->jobs; ++j ) {
+        rc = pthread_join( job_threads[j], &status );
+        if ( rc ) {
+            fprintf( stderr, "Job %d: pthread_join failed: %s.\n",
+                     j, strerror( rc ) );
+            exit( -1 );
+        }
+    }
+
+    print_report( &state );
+
+    for ( c = 0; c < state.num_configs; ++c ) {
+        free( state.configs[c].diff );
+        free( state.configs[c].max );
+    }
+    pthread_mutex_destroy( &state.lock );
+    free( jobs );
+    free( job_threads );
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+/* -k clock and -w mode selections, see sweep_parse_clocks/modes */
+#define SWEEP_CLOCK_REALTIME    0x1
+#define SWEEP_CLOCK_MONOTONIC   0x2
+
+#define SWEEP_MODE_SLEEP        0x1
+#define SWEEP_MODE_ABSTIME      0x2
+#define SWEEP_MODE_TIMER        0x4
+
+struct sweep_options
+{
+    int repeats;
+    int jobs;
+    int num_threads;
+    int use_csv;
+
+    /* restrict the matrix to a single policy */
+    int use_sched;
+    int policy;
+    int priority;
+
+    /* SWEEP_CLOCK_* and SWEEP_MODE_* masks of the columns to run */
+    int clocks;
+    int modes;
+};
+
+int sweep_parse_clocks( const char *list );
+int sweep_parse_modes( const char *list );
+int run_sweep( struct sweep_options *opts );
+
+#endif /* SWEEP_H */
@@ -0,0 +1,65 @@
+#ifndef THREAD_TEST_H
+#define THREAD_TEST_H
+
+#include <time.h>
+#include <pthread.h>
+
+#include "irqstat.h"
+
+#define NUM_TESTS       1000
+/* intervals swept by the engines: 1ns, 10ns, ... 10ms */
+#define NUM_INTERVALS   8
+
+struct interval_result
+{
+    unsigned long interval;
+    unsigned long avg;
+    unsigned long min;
+    unsigned long max;
+    unsigned long overrun;
+};
+
+/*
+ * Shared by every worker of a -i run: one snapshot is taken per interval
+ * while all workers wait at the barrier, so no thread reads /proc in the
+ * middle of another thread's measurement.
+ */
+struct irq_sync
+{
+    pthread_barrier_t barrier;
+    struct irqstat *before;
+    struct irqstat *after;
+    int ok;
+};
+
+struct thread_args
+{
+    int thread_id;
+    int use_csv;
+    int use_abstime;
+    int use_timers;
+    int use_irqstat;
+    int quiet;
+    clockid_t clock_id;
+
+    /* for interrupt attribution */
+    struct irq_sync *irq_sync;
+
+    /* for signals */
+    struct timespec prev;
+    unsigned long min;
+    unsigned long max;
+    unsigned long avg;
+    unsigned long sum;
+    unsigned long overrun;
+
+    /* filled in by the engines, one entry per interval */
+    struct interval_result results[NUM_INTERVALS];
+    int num_results;
+};
+
+void timer_test( struct thread_args *args );
+void sleep_test( struct thread_args *args );
+void run_test( struct thread_args *args );
+
+#endif /* THREAD_TEST_H */